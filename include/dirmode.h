@@ -0,0 +1,43 @@
+/*
+rsa: a simple implementation of RSA encryption and decryption, as
+well as key generation with small primes (8 bits).
+Copyright (C) 2021  Matt Fellenz <mattf53190@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef DIRMODE_H_INCLUDED
+#define DIRMODE_H_INCLUDED
+
+#include <stdbool.h>
+#include "util.h"
+#include "main.h"
+
+#define DIRMODE_MAX_THREADS 64
+
+struct DirJob {
+	enum e_command command; // ENCRYPT or DECRYPT
+	enum e_data_format data_format;
+	unsigned int key;
+	unsigned int modulus;
+	const char* delimiter;
+	const char* in_dir;
+	const char* out_dir; // created if missing. files keep their names.
+};
+
+// encrypts or decrypts every regular file in in_dir (symlinks are skipped) into out_dir with a pool of worker threads.
+// output files have the same contents the stdin mode would print for them, and the input file's permissions plus owner write.
+// returns false (after reporting why) if the directories couldn't be set up, otherwise *failures is the number of files that failed.
+bool process_dir(const struct DirJob* job, unsigned int* failures);
+
+#endif
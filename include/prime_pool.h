@@ -0,0 +1,44 @@
+/*
+rsa: a simple implementation of RSA encryption and decryption, as
+well as key generation with small primes (8 bits).
+Copyright (C) 2021  Matt Fellenz <mattf53190@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef PRIME_POOL_H_INCLUDED
+#define PRIME_POOL_H_INCLUDED
+
+#include <stdbool.h>
+
+#define PRIME_POOL_CAPACITY 64
+
+struct PrimePoolStats {
+	unsigned long hits; // pops served from the pool
+	unsigned long misses; // pops that found it empty
+	unsigned long generated; // primes added by prime_pool_fill
+	unsigned long loaded; // primes read back from the cache file
+};
+
+// the pool is a single process-wide queue of verified primes in the PRIME_N_BITS range.
+// cache_path may be NULL; otherwise primes are loaded from it here and the remaining ones are saved back (mode 0600) by prime_pool_close.
+// the pool never holds a prime twice, and the cache is locked (via <cache>.lock) from here until prime_pool_close,
+// so a cached prime taken by one process is gone from the cache before any other process can load it.
+bool prime_pool_init(const char* cache_path);
+// fills up to target, capped at PRIME_POOL_CAPACITY and at the number of primes in range, returns the pool size
+unsigned int prime_pool_fill(unsigned int target);
+bool prime_pool_pop(unsigned int* result); // never blocks, returns false if the pool is empty or was never initialized
+bool prime_pool_close(void); // saves the remaining primes and releases the cache lock
+void prime_pool_get_stats(struct PrimePoolStats* stats);
+
+#endif
@@ -19,6 +19,8 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #ifndef RSA_H_INCLUDED
 #define RSA_H_INCLUDED
 
+#include <stdbool.h>
+
 #define PRIME_N_BITS 8 // small primes
 #define PRIME_2_N 256 // 2 ^ PRIME_N_BITS
 #define PRIME_2_N_1 128 // 2 ^ (PRIME_N_BITS - 1)
@@ -26,6 +28,9 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 
 #define GET_PRIME_TRIES 400 // ceil(100 * (log2(PRIME_N_BITS) + 1)
 
+#define RSA_DECRYPT_MEMO_BITS 9
+#define RSA_DECRYPT_MEMO_SIZE (1 << RSA_DECRYPT_MEMO_BITS) // must stay above the 256 distinct ciphertexts a char stream can have
+
 struct KeygenResult {
 	unsigned int public;
 	unsigned int private;
@@ -34,9 +39,23 @@ struct KeygenResult {
 	unsigned int q;
 };
 
+// memoizes ciphertext -> plaintext for one key, so repeated characters only cost one exponentiation.
+struct DecryptMemo {
+	unsigned int key;
+	unsigned int modulus;
+	unsigned int ciphers[RSA_DECRYPT_MEMO_SIZE];
+	char plains[RSA_DECRYPT_MEMO_SIZE];
+	bool used[RSA_DECRYPT_MEMO_SIZE];
+	unsigned int filled;
+	unsigned long ciphertexts; // total decrypted through this memo
+	unsigned long exponentiations; // of which actually needed mod_pow
+};
+
 bool get_prime(unsigned int* result);
 unsigned int rsa_encrypt(char plain, unsigned int key, unsigned int modulus);
 char rsa_decrypt(unsigned int cipher, unsigned int key, unsigned int modulus);
+void rsa_decrypt_memo_init(struct DecryptMemo* memo, unsigned int key, unsigned int modulus);
+char rsa_decrypt_memo(struct DecryptMemo* memo, unsigned int cipher);
 void rsa_keygen(struct KeygenResult* result);
 
 #endif
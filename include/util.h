@@ -20,8 +20,11 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #define UTIL_H_INCLUDED
 
 #include <stdbool.h>
+#include <stddef.h>
 
-#define RABIN_MILLER_TRIES 10
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x) // expands x first, so STRINGIFY(SOME_MACRO) gives its value
 
 #define randrange(a, b) (get_random((b) - (a)) + (a)); // [a, b), like python randrange
 
@@ -34,7 +37,8 @@ unsigned int multiplicative_inverse(unsigned int a, unsigned int b);
 enum e_command {
 	ENCRYPT,
 	DECRYPT,
-	KEYGEN
+	KEYGEN,
+	PRIMEGEN
 };
 
 typedef const char* restrict const immutable_string_t;
@@ -0,0 +1,307 @@
+/*
+rsa: a simple implementation of RSA encryption and decryption, as
+well as key generation with small primes (8 bits).
+Copyright (C) 2021  Matt Fellenz <mattf53190@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "rsa.h"
+#include "main.h"
+#include "dirmode.h"
+
+struct Buffer {
+	char* data;
+	size_t len;
+	size_t cap;
+};
+
+enum e_transform_result {
+	TRANSFORM_OK,
+	TRANSFORM_INVALID_INPUT,
+	TRANSFORM_NO_MEMORY
+};
+
+struct DirQueue {
+	const struct DirJob* job;
+	int in_fd;
+	int out_fd;
+	char** names;
+	size_t num_names;
+	size_t next; // index of the next name to hand out, protected by lock
+	unsigned int failures; // protected by lock
+	pthread_mutex_t lock;
+};
+
+static bool buffer_reserve(struct Buffer* const buf, const size_t extra) {
+	if (buf->len + extra <= buf->cap) return true;
+	size_t new_cap = buf->cap == 0 ? 4096 : buf->cap;
+	while (new_cap < buf->len + extra) new_cap *= 2;
+	char* const new_data = realloc(buf->data, new_cap);
+	if (new_data == NULL) return false;
+	buf->data = new_data;
+	buf->cap = new_cap;
+	return true;
+}
+
+static bool buffer_append(struct Buffer* const buf, const char* const data, const size_t len) {
+	if (!buffer_reserve(buf, len)) return false;
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	return true;
+}
+
+static bool buffer_append_uint(struct Buffer* const buf, const unsigned int n) {
+	char digits[16];
+	const int len = snprintf(digits, sizeof(digits), "%u", n);
+	return buffer_append(buf, digits, (size_t)len);
+}
+
+static bool read_whole_file(const int fd, struct Buffer* const buf, mode_t* const mode) {
+	struct stat st;
+	if (fstat(fd, &st) == -1) return false;
+	*mode = st.st_mode & 0777;
+	if (!buffer_reserve(buf, (size_t)st.st_size + 1)) return false;
+	for (;;) {
+		if (!buffer_reserve(buf, 1)) return false;
+		const ssize_t got = pread(fd, buf->data + buf->len, buf->cap - buf->len, (off_t)buf->len);
+		if (got == -1) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		if (got == 0) return true;
+		buf->len += (size_t)got;
+	}
+}
+
+static bool write_whole_file(const int fd, const struct Buffer* const buf) {
+	size_t written = 0;
+	while (written < buf->len) {
+		const ssize_t put = pwrite(fd, buf->data + written, buf->len - written, (off_t)written);
+		if (put == -1) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		written += (size_t)put;
+	}
+	return true;
+}
+
+// parses numbers separated by the delimiter, with the same leniency about whitespace as the scanf-based stdin mode.
+// on success, *out is malloc'd and holds *count numbers.
+static enum e_transform_result parse_numbers(const struct Buffer* const in, const char* const delimiter, unsigned int** const out, size_t* const count_out) {
+	enum e_transform_result result = TRANSFORM_INVALID_INPUT;
+	const size_t delimiter_len = strlen(delimiter);
+	size_t count = 0, cap = 0;
+	unsigned int* numbers = NULL;
+	const char* pos = in->data;
+	const char* const end = in->data + in->len;
+	for (;;) {
+		while (pos < end && isspace(*pos)) pos += sizeof(char);
+		if (pos == end) break;
+		if (!isdigit(*pos)) goto fail;
+		unsigned long n = 0;
+		for (; pos < end && isdigit(*pos); pos += sizeof(char)) {
+			n = n * 10 + (unsigned long)(*pos - '0');
+			if (n > UINT_MAX) goto fail;
+		}
+		if (count == cap) {
+			cap = cap == 0 ? 1024 : cap * 2;
+			unsigned int* const new_numbers = realloc(numbers, cap * sizeof(*numbers));
+			if (new_numbers == NULL) {
+				result = TRANSFORM_NO_MEMORY;
+				goto fail;
+			}
+			numbers = new_numbers;
+		}
+		numbers[count++] = (unsigned int)n;
+		if ((size_t)(end - pos) >= delimiter_len && memcmp(pos, delimiter, delimiter_len) == 0) pos += delimiter_len;
+	}
+	*out = numbers;
+	*count_out = count;
+	return TRANSFORM_OK;
+fail:
+	free(numbers);
+	return result;
+}
+
+static enum e_transform_result transform(const struct DirJob* const job, const struct Buffer* const in, struct Buffer* const out) {
+	const size_t delimiter_len = strlen(job->delimiter);
+	if (in->len == 0) return TRANSFORM_OK; // like stdin, no input means no output
+	if (job->command == ENCRYPT && job->data_format == CHARS) {
+		for (size_t i = 0; i < in->len; i++) {
+			if (i != 0 && !buffer_append(out, job->delimiter, delimiter_len)) return TRANSFORM_NO_MEMORY;
+			if (!buffer_append_uint(out, rsa_encrypt(in->data[i], job->key, job->modulus))) return TRANSFORM_NO_MEMORY;
+		}
+		return buffer_append(out, "\n", 1) ? TRANSFORM_OK : TRANSFORM_NO_MEMORY;
+	}
+	unsigned int* numbers;
+	size_t count;
+	const enum e_transform_result parsed = parse_numbers(in, job->delimiter, &numbers, &count);
+	if (parsed != TRANSFORM_OK) return parsed;
+	bool ok = true;
+	if (job->command == ENCRYPT) {
+		for (size_t i = 0; ok && i < count; i++) {
+			if (i != 0) ok = buffer_append(out, job->delimiter, delimiter_len);
+			if (ok) ok = buffer_append_uint(out, mod_pow(numbers[i], job->key, job->modulus));
+		}
+		if (ok) ok = buffer_append(out, "\n", 1);
+	} else {
+		struct DecryptMemo* const memo = malloc(sizeof(*memo));
+		ok = memo != NULL && buffer_reserve(out, count);
+		if (ok) {
+			rsa_decrypt_memo_init(memo, job->key, job->modulus);
+			for (size_t i = 0; i < count; i++) out->data[i] = rsa_decrypt_memo(memo, numbers[i]);
+			out->len = count;
+		}
+		free(memo);
+	}
+	free(numbers);
+	return ok ? TRANSFORM_OK : TRANSFORM_NO_MEMORY; // every failure past parsing is an allocation
+}
+
+static bool process_file(const struct DirQueue* const queue, const char* const name) {
+	verbose_logf("processing file %s\n", name);
+	struct Buffer in = {0}, out = {0};
+	bool ok = false;
+	mode_t mode;
+	const int in_file = openat(queue->in_fd, name, O_RDONLY | O_NOFOLLOW); // symlinks were skipped when listing, don't let one swapped in now escape the directory
+	if (in_file == -1) goto done;
+	ok = read_whole_file(in_file, &in, &mode);
+	close(in_file);
+	if (!ok) goto done;
+	const enum e_transform_result result = transform(queue->job, &in, &out);
+	ok = result == TRANSFORM_OK;
+	if (result == TRANSFORM_INVALID_INPUT) {
+		fprintf(stderr, "rsa: invalid input in file '%s'\n", name);
+		errno = 0; // already reported
+		goto done;
+	}
+	if (result == TRANSFORM_NO_MEMORY) {
+		errno = ENOMEM;
+		goto done;
+	}
+	// open's mode only applies to new files, so an existing output file is chmod'ed too. private input stays private,
+	// but the output stays writable by its owner so that re-running into the same --out-dir works for read-only input.
+	const int out_file = openat(queue->out_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+	ok = out_file != -1 && fchmod(out_file, mode | S_IWUSR) == 0 && write_whole_file(out_file, &out);
+	if (out_file != -1) close(out_file);
+done:
+	if (!ok && errno != 0) fprintf(stderr, "rsa: %s: %s\n", name, strerror(errno));
+	free(in.data);
+	free(out.data);
+	return ok;
+}
+
+static void* worker(void* const arg) {
+	struct DirQueue* const queue = arg;
+	for (;;) {
+		pthread_mutex_lock(&queue->lock);
+		const size_t index = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+		if (index >= queue->num_names) return NULL;
+		errno = 0;
+		if (!process_file(queue, queue->names[index])) {
+			pthread_mutex_lock(&queue->lock);
+			queue->failures++;
+			pthread_mutex_unlock(&queue->lock);
+		}
+	}
+}
+
+static bool list_regular_files(const int dir_fd, char*** const names, size_t* const num_names) {
+	DIR* const dir = fdopendir(dup(dir_fd));
+	if (dir == NULL) return false;
+	size_t cap = 0;
+	*names = NULL;
+	*num_names = 0;
+	for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+		struct stat st;
+		// symlinks aren't followed, they could point anywhere outside the input directory
+		if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISREG(st.st_mode)) continue;
+		if (*num_names == cap) {
+			cap = cap == 0 ? 64 : cap * 2;
+			char** const new_names = realloc(*names, cap * sizeof(**names));
+			if (new_names == NULL) goto fail;
+			*names = new_names;
+		}
+		char* const name = strdup(entry->d_name);
+		if (name == NULL) goto fail;
+		(*names)[(*num_names)++] = name;
+	}
+	closedir(dir);
+	return true;
+fail: // skipping the rest would silently leave files unprocessed
+	for (size_t i = 0; i < *num_names; i++) free((*names)[i]);
+	free(*names);
+	*names = NULL;
+	*num_names = 0;
+	closedir(dir);
+	return false;
+}
+
+bool process_dir(const struct DirJob* const job, unsigned int* const failures) {
+	struct DirQueue queue = { .job = job };
+	queue.in_fd = open(job->in_dir, O_RDONLY | O_DIRECTORY);
+	if (queue.in_fd == -1) {
+		fprintf(stderr, "rsa: %s: %s\n", job->in_dir, strerror(errno));
+		return false;
+	}
+	if (mkdir(job->out_dir, 0755) == -1 && errno != EEXIST) {
+		fprintf(stderr, "rsa: %s: %s\n", job->out_dir, strerror(errno));
+		close(queue.in_fd);
+		return false;
+	}
+	queue.out_fd = open(job->out_dir, O_RDONLY | O_DIRECTORY);
+	if (queue.out_fd == -1 || !list_regular_files(queue.in_fd, &queue.names, &queue.num_names)) {
+		perror("rsa");
+		close(queue.in_fd);
+		if (queue.out_fd != -1) close(queue.out_fd);
+		return false;
+	}
+	long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads < 1) num_threads = 1;
+	if (num_threads > DIRMODE_MAX_THREADS) num_threads = DIRMODE_MAX_THREADS;
+	if ((size_t)num_threads > queue.num_names) num_threads = (long)queue.num_names;
+	verbose_logf("processing %zu files with %ld threads\n", queue.num_names, num_threads);
+
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_t threads[DIRMODE_MAX_THREADS];
+	long started = 0;
+	for (; started < num_threads; started++) {
+		if (pthread_create(&threads[started], NULL, worker, &queue) != 0) break;
+	}
+	if (started == 0) worker(&queue); // couldn't spawn anything, so do it on this thread
+	for (long i = 0; i < started; i++) pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&queue.lock);
+
+	for (size_t i = 0; i < queue.num_names; i++) free(queue.names[i]);
+	free(queue.names);
+	close(queue.in_fd);
+	close(queue.out_fd);
+	*failures = queue.failures;
+	return true;
+}
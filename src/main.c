@@ -25,6 +25,8 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include "util.h"
 #include "rsa.h"
 #include "main.h"
+#include "dirmode.h"
+#include "prime_pool.h"
 
 enum e_verbosity verbosity = DEFAULT;
 
@@ -36,6 +38,8 @@ int main(const int argc, const char* const* const argv) {
 	   -h, --help, --usage : print usage and exit
 	   -f<arg>, --format <arg> : the format of plaintext, either `chars` (default, raw characters) or `numbers` (unsigned ints). The ciphertext is always in numbers format due to technical restrictions.
 	   -d<arg>, --delimiter <arg> : the delimiter between the numbers when in numbers mode. A space by default. Can't include digits.
+	   --prime-cache <arg> : file of pregenerated primes for keygen and primegen.
+	   --in-dir <arg>, --out-dir <arg> : encrypt or decrypt every file in a directory instead of a single message.
 	*/
 	// ↓ stores pointers to the text arguments (as opposed to options)
 	char* text_args[5]; // max number of text args is (I believe) three, so five is plenty.
@@ -43,6 +47,9 @@ int main(const int argc, const char* const* const argv) {
 	bool wants_help = false;
 	enum e_data_format data_format = CHARS;
 	char* delimiter = " ";
+	const char* in_dir = NULL;
+	const char* out_dir = NULL;
+	const char* prime_cache = NULL;
 	for (int arg_pos = 1; arg_pos < argc; arg_pos++) {
 		const char* this_arg = argv[arg_pos];
 		if (this_arg[0] == '-') { // starts with -, short or long option (or just - or --)
@@ -62,7 +69,14 @@ int main(const int argc, const char* const* const argv) {
 					else if (streq(this_arg, "quiet")) verbosity = QUIET;
 					else if (streq(this_arg, "version")) { puts(VERSION_STRING); exit(0); }
 					else if (streq(this_arg, "help") || streq(this_arg, "usage")) wants_help = true;
-					else {
+					else if (streq(this_arg, "prime-cache")) {
+						if (arg_pos + 1 >= argc) print_generic_usage_with_complaint_and_readback_string("argument required for option", this_arg - 2 * sizeof(char));
+						prime_cache = argv[++arg_pos];
+					} else if (streq(this_arg, "in-dir") || streq(this_arg, "out-dir")) {
+						if (arg_pos + 1 >= argc) print_generic_usage_with_complaint_and_readback_string("argument required for option", this_arg - 2 * sizeof(char));
+						if (this_arg[0] == 'i') in_dir = argv[++arg_pos];
+						else out_dir = argv[++arg_pos];
+					} else {
 						const bool was_format = streq(this_arg, "format");
 						if (was_format || streq(this_arg, "delimiter")) {
 							if (arg_pos + 1 >= argc) print_generic_usage_with_complaint_and_readback_string("argument required for option", this_arg - 2 * sizeof(char)); // off-by-one? couldn't be me
@@ -144,15 +158,44 @@ int main(const int argc, const char* const* const argv) {
 	} else {
 		if (streq(text_args[0], "keygen")) {
 			if (__builtin_expect(wants_help, 0)) print_specific_usage(KEYGEN, false);
+			if (prime_cache != NULL && !prime_pool_init(prime_cache)) exit(EXIT_INTERNAL_ERROR);
 			struct KeygenResult result;
 			rsa_keygen(&result);
+			if (prime_cache != NULL) {
+				struct PrimePoolStats stats;
+				prime_pool_get_stats(&stats);
+				verbose_logf("prime pool: %lu hits, %lu misses, %lu loaded from cache\n", stats.hits, stats.misses, stats.loaded);
+				// drop the primes we took from the cache before anyone sees the key, so being killed later can't reuse them.
+				// refilling is left to primegen, so keygen never holds the cache lock longer than it needs to.
+				if (!prime_pool_close()) exit(EXIT_INTERNAL_ERROR);
+			}
 			printf(verbosity == QUIET ? "%u\n%u\n%u\n" : "public key: %u\nprivate key: %u\nmodulus: %u\n", result.public, result.private, result.modulo);
+		} else if (streq(text_args[0], "primegen")) {
+			if (__builtin_expect(wants_help, 0)) print_specific_usage(PRIMEGEN, false);
+			unsigned int count = PRIME_POOL_CAPACITY;
+			if (text_arg_index >= 2 && (!str_to_uint_safe(text_args[1], &count) || count > PRIME_POOL_CAPACITY))
+				print_specific_usage(PRIMEGEN, true);
+			if (prime_cache == NULL) {
+				fputs("primegen requires --prime-cache\n", stderr);
+				print_specific_usage(PRIMEGEN, true);
+			}
+			if (!prime_pool_init(prime_cache)) exit(EXIT_INTERNAL_ERROR);
+			const unsigned int pool_size = prime_pool_fill(count);
+			struct PrimePoolStats stats;
+			prime_pool_get_stats(&stats);
+			if (!prime_pool_close()) exit(EXIT_INTERNAL_ERROR);
+			printf(verbosity == QUIET ? "%u\n%lu\n" : "primes in cache: %u\nnewly generated: %lu\n", pool_size, stats.generated);
 		} else {
 			const bool are_encrypting = streq(text_args[0], "encrypt");
 			if (are_encrypting || streq(text_args[0], "decrypt")) {
 				if (__builtin_expect(wants_help, 0)) print_specific_usage(are_encrypting ? ENCRYPT : DECRYPT, false);
 				verbose_log("encrypting or decrypting\n");
-				if (text_arg_index < 4) {
+				const bool dir_mode = in_dir != NULL || out_dir != NULL;
+				if (dir_mode && (in_dir == NULL || out_dir == NULL)) {
+					fputs("--in-dir and --out-dir must be used together\n", stderr);
+					print_specific_usage(are_encrypting ? ENCRYPT : DECRYPT, true);
+				}
+				if (dir_mode ? text_arg_index != 3 : text_arg_index < 4) { // a message in dir mode would be silently ignored
 					print_specific_usage(are_encrypting ? ENCRYPT : DECRYPT, true);
 				}
 				unsigned int key;
@@ -165,6 +208,25 @@ int main(const int argc, const char* const* const argv) {
 					print_specific_usage(are_encrypting ? ENCRYPT : DECRYPT, true);
 				verbose_logf("got modulus %u\n", mod);
 
+				if (dir_mode) {
+					const struct DirJob job = {
+						.command = are_encrypting ? ENCRYPT : DECRYPT,
+						.data_format = data_format,
+						.key = key,
+						.modulus = mod,
+						.delimiter = delimiter,
+						.in_dir = in_dir,
+						.out_dir = out_dir
+					};
+					unsigned int failures;
+					if (!process_dir(&job, &failures)) exit(EXIT_INTERNAL_ERROR); // already reported
+					if (failures != 0) {
+						if (verbosity != QUIET) fprintf(stderr, "rsa: %u file(s) failed\n", failures);
+						exit(EXIT_INTERNAL_ERROR);
+					}
+					exit(EXIT_SUCCESS);
+				}
+
 				const bool from_stdin = streq(text_args[3], "-");
 				if (are_encrypting && data_format == CHARS) {
 					verbose_log("encrypting in fchars ");
@@ -199,6 +261,9 @@ int main(const int argc, const char* const* const argv) {
 					verbose_log(are_encrypting ? "decrypting " : "encrypting in fnumbers ");
 					char escaped_delimiter[2 * strlen(delimiter) + 1];
 					str_scanf_escape(delimiter, escaped_delimiter);
+					// repeated ciphertexts only cost one exponentiation, see rsa_decrypt_memo
+					struct DecryptMemo memo;
+					rsa_decrypt_memo_init(&memo, key, mod);
 					if (from_stdin) {
 						verbose_log("from stdin\n");
 						unsigned int parsed;
@@ -223,7 +288,7 @@ int main(const int argc, const char* const* const argv) {
 									fputs(delimiter, stdout);
 								} else is_not_first = true;
 								printf("%u", mod_pow(parsed, key, mod));
-							} else putchar(rsa_decrypt(parsed, key, mod));
+							} else putchar(rsa_decrypt_memo(&memo, parsed));
 							scan_result = scanf("%u", &parsed);
 							scanf(escaped_delimiter);
 						}
@@ -258,10 +323,11 @@ int main(const int argc, const char* const* const argv) {
 									fputs("got invalid ciphertext number, i.e., was not a number\n", stderr);
 									print_specific_usage(DECRYPT, true);
 								}
-							} else putchar(rsa_decrypt(parsed, key, mod));
+							} else putchar(rsa_decrypt_memo(&memo, parsed));
 						}
 					}
 					if (are_encrypting) putchar('\n');
+					else verbose_logf("decrypted %lu ciphertexts with %lu exponentiations (%.3f per ciphertext, vs 1 one-at-a-time)\n", memo.ciphertexts, memo.exponentiations, memo.ciphertexts == 0 ? 0.0 : (double)memo.exponentiations / (double)memo.ciphertexts);
 				}
 			} else {
 				print_generic_usage_with_complaint_and_readback_string("unknown action", text_args[0]);
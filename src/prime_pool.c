@@ -0,0 +1,235 @@
+/*
+rsa: a simple implementation of RSA encryption and decryption, as
+well as key generation with small primes (8 bits).
+Copyright (C) 2021  Matt Fellenz <mattf53190@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "util.h"
+#include "rsa.h"
+#include "main.h"
+#include "prime_pool.h"
+
+static struct {
+	unsigned int primes[PRIME_POOL_CAPACITY]; // ring buffer, protected by lock like everything below
+	unsigned int head;
+	unsigned int count;
+	struct PrimePoolStats stats;
+	const char* cache_path;
+	int lock_fd; // flock'ed <cache>.lock, held from prime_pool_init until prime_pool_close has saved
+	unsigned int in_range; // how many distinct primes PRIME_N_BITS has room for, the pool can never hold more
+	bool initialized;
+	pthread_mutex_t lock;
+} pool = { .lock_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static bool is_valid_prime(const unsigned int n) {
+	return n >= PRIME_2_N_1 && n < PRIME_2_N && is_prime(n);
+}
+
+// plain trial division rather than is_prime, which would log every one of these with -v
+static unsigned int count_primes_in_range(void) {
+	unsigned int count = 0;
+	for (unsigned int n = PRIME_2_N_1; n < PRIME_2_N; n++) {
+		bool composite = n < 2;
+		for (unsigned int d = 2; !composite && d * d <= n; d++) composite = n % d == 0;
+		if (!composite) count++;
+	}
+	return count;
+}
+
+// every prime is in the pool at most once, so two pops never return the same one
+static bool push_locked(const unsigned int prime) {
+	if (pool.count == PRIME_POOL_CAPACITY) return false;
+	for (unsigned int i = 0; i < pool.count; i++) {
+		if (pool.primes[(pool.head + i) % PRIME_POOL_CAPACITY] == prime) return false;
+	}
+	pool.primes[(pool.head + pool.count) % PRIME_POOL_CAPACITY] = prime;
+	pool.count++;
+	return true;
+}
+
+// the cache is replaced by rename on every save, so the lock has to live in a file of its own.
+// without it, two processes could load the same primes and hand out keys sharing p and q.
+static bool lock_cache(const char* const path) {
+	char lock_path[strlen(path) + sizeof(".lock")];
+	strcpy(lock_path, path);
+	strcat(lock_path, ".lock");
+	pool.lock_fd = open(lock_path, O_RDWR | O_CREAT | O_NOFOLLOW, 0600);
+	if (pool.lock_fd == -1) {
+		fprintf(stderr, "rsa: %s: %s\n", lock_path, strerror(errno));
+		return false;
+	}
+	verbose_logf("waiting for lock on %s\n", lock_path);
+	while (flock(pool.lock_fd, LOCK_EX) == -1) {
+		if (errno == EINTR) continue;
+		fprintf(stderr, "rsa: %s: %s\n", lock_path, strerror(errno));
+		close(pool.lock_fd);
+		pool.lock_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+static void unlock_cache(void) {
+	if (pool.lock_fd == -1) return;
+	close(pool.lock_fd); // releases the flock
+	pool.lock_fd = -1;
+}
+
+static bool load_cache(const char* const path) {
+	const int fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd == -1) {
+		if (errno == ENOENT) return true; // nothing cached yet is fine
+		fprintf(stderr, "rsa: %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, "rsa: %s: %s\n", path, strerror(errno));
+		close(fd);
+		return false;
+	}
+	if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077) != 0) {
+		fprintf(stderr, "rsa: refusing to use prime cache '%s' since it is not a regular file private to you\n", path);
+		close(fd);
+		return false;
+	}
+	FILE* const f = fdopen(fd, "r");
+	if (f == NULL) {
+		close(fd);
+		return false;
+	}
+	unsigned int prime;
+	while (pool.count < PRIME_POOL_CAPACITY && fscanf(f, "%u", &prime) == 1) {
+		if (!is_valid_prime(prime)) { // don't trust the file blindly
+			verbose_logf("discarding cached non-prime %u\n", prime);
+			continue;
+		}
+		if (!push_locked(prime)) {
+			verbose_logf("discarding duplicate cached prime %u\n", prime);
+			continue;
+		}
+		pool.stats.loaded++;
+	}
+	fclose(f);
+	return true;
+}
+
+static bool save_cache(const char* const path) {
+	char tmp_path[strlen(path) + sizeof(".tmp")];
+	strcpy(tmp_path, path);
+	strcat(tmp_path, ".tmp");
+	// a leftover .tmp could have any mode, which rename would carry over to the cache, or be a symlink to somewhere else.
+	// we hold the cache lock, so nothing else is writing it and it can be replaced by a fresh private file.
+	if (unlink(tmp_path) == -1 && errno != ENOENT) return false;
+	const int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+	if (fd == -1) return false;
+	if (fchmod(fd, 0600) == -1) { // in case umask took bits away from the owner
+		close(fd);
+		unlink(tmp_path);
+		return false;
+	}
+	FILE* const f = fdopen(fd, "w");
+	if (f == NULL) {
+		close(fd);
+		unlink(tmp_path);
+		return false;
+	}
+	for (unsigned int i = 0; i < pool.count; i++) {
+		fprintf(f, "%u\n", pool.primes[(pool.head + i) % PRIME_POOL_CAPACITY]);
+	}
+	// written to a temporary file and renamed over the cache so a crash mid-save leaves either the old or the new contents
+	if (fclose(f) != 0 || rename(tmp_path, path) == -1) {
+		unlink(tmp_path);
+		return false;
+	}
+	return true;
+}
+
+bool prime_pool_init(const char* const cache_path) {
+	verbose_logf("initializing prime pool with cache %s\n", cache_path == NULL ? "(none)" : cache_path);
+	pthread_mutex_lock(&pool.lock);
+	pool.head = 0;
+	pool.count = 0;
+	memset(&pool.stats, 0, sizeof(pool.stats));
+	pool.cache_path = cache_path;
+	if (pool.in_range == 0) pool.in_range = count_primes_in_range();
+	bool ok = cache_path == NULL || lock_cache(cache_path);
+	if (ok && cache_path != NULL && !load_cache(cache_path)) {
+		unlock_cache();
+		ok = false;
+	}
+	pool.initialized = ok;
+	pthread_mutex_unlock(&pool.lock);
+	return ok;
+}
+
+unsigned int prime_pool_fill(unsigned int target) {
+	pthread_mutex_lock(&pool.lock);
+	if (target > PRIME_POOL_CAPACITY) target = PRIME_POOL_CAPACITY;
+	if (target > pool.in_range) target = pool.in_range; // asking for more would never finish
+	while (pool.initialized && pool.count < target) {
+		pthread_mutex_unlock(&pool.lock);
+		unsigned int prime;
+		const bool got = get_prime(&prime);
+		pthread_mutex_lock(&pool.lock);
+		if (got && push_locked(prime)) pool.stats.generated++;
+	}
+	const unsigned int count = pool.count;
+	pthread_mutex_unlock(&pool.lock);
+	return count;
+}
+
+bool prime_pool_pop(unsigned int* const result) {
+	pthread_mutex_lock(&pool.lock);
+	const bool hit = pool.initialized && pool.count != 0;
+	if (hit) {
+		*result = pool.primes[pool.head];
+		pool.head = (pool.head + 1) % PRIME_POOL_CAPACITY;
+		pool.count--;
+		pool.stats.hits++;
+	} else if (pool.initialized) pool.stats.misses++;
+	pthread_mutex_unlock(&pool.lock);
+	verbose_logf(hit ? "prime pool hit: %u\n" : "prime pool miss\n", hit ? *result : 0);
+	return hit;
+}
+
+bool prime_pool_close(void) {
+	pthread_mutex_lock(&pool.lock);
+	bool ok = true;
+	if (pool.initialized && pool.cache_path != NULL) {
+		ok = save_cache(pool.cache_path);
+		if (!ok) perror("rsa: could not save prime cache");
+	}
+	unlock_cache();
+	pool.initialized = false;
+	pthread_mutex_unlock(&pool.lock);
+	return ok;
+}
+
+void prime_pool_get_stats(struct PrimePoolStats* const stats) {
+	pthread_mutex_lock(&pool.lock);
+	*stats = pool.stats;
+	pthread_mutex_unlock(&pool.lock);
+}
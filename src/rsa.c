@@ -25,6 +25,7 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include "util.h"
 #include "rsa.h"
 #include "main.h"
+#include "prime_pool.h"
 
 bool get_prime(unsigned int* const result) {
 	verbose_log("getting a prime\n");
@@ -51,12 +52,41 @@ char rsa_decrypt(const unsigned int cipher, const unsigned int key, const unsign
 	return (char)mod_pow(cipher, key, modulus);
 }
 
+void rsa_decrypt_memo_init(struct DecryptMemo* const memo, const unsigned int key, const unsigned int modulus) {
+	memset(memo, 0, sizeof(*memo));
+	memo->key = key;
+	memo->modulus = modulus;
+}
+
+char rsa_decrypt_memo(struct DecryptMemo* const memo, const unsigned int cipher) {
+	memo->ciphertexts++;
+	unsigned int slot = (cipher * 2654435761u) >> (32 - RSA_DECRYPT_MEMO_BITS); // fibonacci hashing
+	while (memo->used[slot] && memo->ciphers[slot] != cipher) {
+		slot = (slot + 1) & (RSA_DECRYPT_MEMO_SIZE - 1);
+	}
+	if (memo->used[slot]) return memo->plains[slot];
+	const char plain = rsa_decrypt(cipher, memo->key, memo->modulus);
+	memo->exponentiations++;
+	if (memo->filled < RSA_DECRYPT_MEMO_SIZE / 2) { // keep probe chains short; past this just stop memoizing
+		memo->used[slot] = true;
+		memo->ciphers[slot] = cipher;
+		memo->plains[slot] = plain;
+		memo->filled++;
+	}
+	return plain;
+}
+
+static void next_prime(unsigned int* const result) {
+	// the pool only has primes if the caller set it up, otherwise this is the plain random search
+	if (!prime_pool_pop(result)) get_prime(result);
+}
+
 void rsa_keygen(struct KeygenResult* const result) {
 	verbose_log("generating keys\n");
-	get_prime(&(result->p));
+	next_prime(&(result->p));
 	verbose_logf("got p %u\n", result->p);
 	do {
-		get_prime(&(result->q));
+		next_prime(&(result->q));
 		verbose_logf("trying q %u\n", result->q);
 	} while (result->p == result->q);
 	verbose_logf("final q was %u\n", result->q);
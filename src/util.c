@@ -21,38 +21,48 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include <string.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <stdint.h>
 #include <math.h>
+#include <pthread.h>
 #include "util.h"
 #include "rsa.h"
 #include "main.h"
+#include "prime_pool.h"
 
-static const unsigned short low_primes[] = {
-	3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89,
-	97, 101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173,
-	179, 181, 191, 193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251, 257, 263,
-	269, 271, 277, 281, 283, 293, 307, 311, 313, 317, 331, 337, 347, 349, 353, 359,
-	367, 373, 379, 383, 389, 397, 401, 409, 419, 421, 431, 433, 439, 443, 449, 457,
-	461, 463, 467, 479, 487, 491, 499, 503, 509, 521, 523, 541, 547, 557, 563, 569,
-	571, 577, 587, 593, 599, 601, 607, 613, 617, 619, 631, 641, 643, 647, 653, 659,
-	661, 673, 677, 683, 691, 701, 709, 719, 727, 733, 739, 743, 751, 757, 761, 769,
-	773, 787, 797, 809, 811, 821, 823, 827, 829, 839, 853, 857, 859, 863, 877, 881,
-	883, 887, 907, 911, 919, 929, 937, 941, 947, 953, 967, 971, 977, 983, 991, 997
+struct LowPrime {
+	uint32_t prime;
+	uint32_t inverse; // prime * inverse == 1 (mod 2^32)
+	uint32_t limit; // (2^32 - 1) / prime
 };
 
-static const unsigned char num_low_primes = 167;
+#include "low_primes.h" // generated by the Makefile, NUM_LOW_PRIMES is a build parameter
+
+static FILE* random_source;
+
+static void open_random_source(void) {
+	random_source = fopen("/dev/random", "r");
+}
 
 unsigned int get_random(const unsigned int max) {
 	const unsigned int limit = UINT_MAX - (UINT_MAX % max);
 	unsigned int r;
 
-	FILE* f = fopen("/dev/random", "r");
+	// opened once and kept for the whole process, so stdio's buffer serves many calls per read().
+	// opening it per call used to dominate Miller-Rabin. fread locks the FILE, so this is thread safe.
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, open_random_source);
+	if (random_source == NULL) {
+		perror("rsa: /dev/random");
+		exit(EXIT_INTERNAL_ERROR);
+	}
 
 	do {
-		fread(&r, sizeof(r), 1, f);
+		if (fread(&r, sizeof(r), 1, random_source) != 1) {
+			perror("rsa: /dev/random");
+			exit(EXIT_INTERNAL_ERROR);
+		}
 	} while (r >= limit);
 
-	fclose(f);
-
 	verbose_logf("got random %u (mod %u for final result)\n", r, max);
 
 	return r % max;
@@ -94,51 +104,86 @@ unsigned int multiplicative_inverse(unsigned int a, unsigned int b) {
 #pragma GCC diagnostic pop
 }
 
-bool rabin_miller_check(unsigned int base, const unsigned int limit, const unsigned int exp, const unsigned int modulus) {
-	verbose_logf("rabin miller check with base %u, limit %u, exponent %u, and modulus %u\n", base, limit, exp, modulus);
-	base = mod_pow(base, exp, modulus);
-	if (base == 1) return true;
-	for (unsigned int i = 1; i < limit - 1; i++) {
-		if (base == modulus - 1) return true;
-		base = mod_pow(base, 2, modulus);
+// returns true and sets *result if trial division alone settles whether n is prime.
+static bool trial_divide(const unsigned int n, bool* const result) {
+	if (n < 3 || n % 2 == 0) {
+		*result = false;
+		return true;
+	}
+	for (unsigned int i = 0; i < NUM_LOW_PRIMES; i++) {
+		const struct LowPrime* const p = &low_primes[i];
+		if ((unsigned long)p->prime * p->prime > n) { // no factor up to sqrt(n), so definitely prime
+			*result = true;
+			return true;
+		}
+		if ((uint32_t)n * p->inverse <= p->limit) { // i.e., n % p->prime == 0 without dividing
+			*result = false;
+			return true;
+		}
 	}
-	return base == modulus - 1;
+	return false;
 }
 
-bool rabin_miller(const unsigned int n) {
-	verbose_logf("rabin miller with %u\n", n);
-	if (n == 2) return true;
-	if (n % 2 == 0) return false;
+_Static_assert(sizeof(unsigned int) == 4, "the witnesses below are only deterministic for 32-bit candidates");
+static const unsigned int deterministic_witnesses[] = {2, 7, 61}; // no composite below 4759123141 is a strong pseudoprime to all three (Jaeschke 1993)
 
-	unsigned int limit = 0;
-	unsigned int exp = n - 1;
+// an odd modulus n set up for montgomery multiplication with R = 2^32, plus n - 1 = d * 2^s.
+struct Montgomery {
+	uint32_t n;
+	uint32_t n_neg_inv; // -n^-1 mod 2^32
+	uint32_t one; // R mod n, i.e., 1 in montgomery form
+	uint32_t d;
+	unsigned int s;
+};
 
-	while (exp % 2 == 0) {
-		exp /= 2;
-		limit += 1;
-	}
+static void montgomery_setup(struct Montgomery* const mont, const uint32_t n) {
+	mont->n = n;
+	uint32_t inverse = n; // correct to 3 bits for odd n, each newton step doubles that
+	for (int i = 0; i < 4; i++) inverse *= 2 - n * inverse;
+	mont->n_neg_inv = -inverse;
+	mont->one = (uint32_t)((1ul << 32) % n);
+	mont->s = (unsigned int)__builtin_ctz(n - 1);
+	mont->d = (n - 1) >> mont->s;
+}
 
-	for (unsigned int i = 1; i < RABIN_MILLER_TRIES; i++) {
-		verbose_logf("  iterate: ");
-		const unsigned int base = randrange(2, n - 1);
-		if (!rabin_miller_check(base, limit, exp, n)) return false;
+// a * b / R mod n for a, b < n. unlike mod_pow this never goes through the hardware divider.
+static inline uint32_t montgomery_multiply(const uint32_t a, const uint32_t b, const struct Montgomery* const mont) {
+	const uint64_t t = (uint64_t)a * b;
+	const uint64_t mn = (uint64_t)((uint32_t)t * mont->n_neg_inv) * mont->n;
+	// the low halves of t and mn sum to exactly 0 or 2^32, so only the carry is needed from them
+	const uint64_t u = (t >> 32) + (mn >> 32) + ((uint32_t)t != 0);
+	return (uint32_t)(u >= mont->n ? u - mont->n : u);
+}
+
+// strong probable prime test of n to one witness. primes always pass.
+static bool strong_probable_prime(const struct Montgomery* const mont, const unsigned int witness) {
+	if (witness % mont->n == 0) return true; // says nothing, which only happens for n <= 61 with a tiny trial division table
+	const uint32_t minus_one = mont->n - mont->one;
+	uint32_t result = mont->one;
+	uint32_t base = (uint32_t)(((uint64_t)witness << 32) % mont->n);
+	for (uint32_t exp = mont->d; exp != 0; exp >>= 1) { // witness^d mod n, right to left
+		if (exp & 1) result = montgomery_multiply(result, base, mont);
+		base = montgomery_multiply(base, base, mont);
 	}
-	return true;
+	if (result == mont->one || result == minus_one) return true;
+	for (unsigned int i = 1; i < mont->s; i++) {
+		result = montgomery_multiply(result, result, mont);
+		if (result == minus_one) return true;
+	}
+	return false;
 }
 
 bool is_prime(const unsigned int n) {
-	// will always properly identify composites, but sometimes considers primes composites. Fine for our use case.
+	// exact: trial division, then Miller-Rabin with witnesses that are deterministic for 32 bits.
 	verbose_logf("checking if %u is prime\n", n);
-	if (n >= 3 && n % 2 == 1) {
-		for (int i = 0; i < num_low_primes; i++) {
-			unsigned int p;
-			p = low_primes[i];
-			if (n == p) return true;
-			if (n % p == 0) return false;
-		}
-		return rabin_miller(n);
+	bool result;
+	if (trial_divide(n, &result)) return result;
+	struct Montgomery mont;
+	montgomery_setup(&mont, n);
+	for (size_t w = 0; w < sizeof(deterministic_witnesses) / sizeof(*deterministic_witnesses); w++) {
+		if (!strong_probable_prime(&mont, deterministic_witnesses[w])) return false;
 	}
-	return false;
+	return true;
 }
 
 unsigned int mod_pow(unsigned long base, unsigned int exp, const unsigned int mod) {
@@ -182,8 +227,11 @@ void print_generic_usage(const bool in_error) {
 	fputs(
 		"COMMANDS:\n"
 		"  encrypt <key> <modulus> <plaintext>\n"
+		"  encrypt <key> <modulus> --in-dir <dir> --out-dir <dir>\n"
 		"  decrypt <key> <modulus> <ciphertext>\n"
+		"  decrypt <key> <modulus> --in-dir <dir> --out-dir <dir>\n"
 		"  keygen\n"
+		"  primegen [count]\n"
 		"if plaintext or ciphertext is '-', read from stdin.\n"
 		"OPTIONS:\n"
 		"  -v, --verbose: print detailed progress info along with output.\n"
@@ -193,6 +241,8 @@ void print_generic_usage(const bool in_error) {
 		"  -h, --help, --usage: print usage and exit.\n"
 		"  -f<arg>, --format <arg>: the format of plaintext, either `chars` (default, raw characters) or `numbers` (unsigned ints). The ciphertext is always in numbers format due to technical restrictions.\n"
 		"  -d<arg>, --delimiter <arg>: the delimiter between the numbers when in numbers mode. A space by default. Cannot include digits.\n"
+		"  --prime-cache <arg>: file of pregenerated primes that keygen takes its primes from and primegen fills. must only be accessible by you.\n"
+		"  --in-dir <arg>, --out-dir <arg>: process every regular file in the input directory in parallel (symlinks are skipped), writing results under the same names in the output directory (created if missing).\n"
 		"if multiple of -v, -b, and/or -q are provided, the last takes precedence. Same with multiple formats or delimiters.\n",
 		in_error ? stderr : stdout
 	);
@@ -204,6 +254,7 @@ void print_specific_usage(const enum e_command command, const bool in_error) {
 			fputs(
 				"HELP WITH encrypt:\n"
 				"  encrypt <key> <modulus> <plaintext>\n"
+				"  encrypt <key> <modulus> --in-dir <dir> --out-dir <dir>\n"
 				"arguments:\n"
 				"  key: an unsigned integer representing the public/private key as generated by the keygen command\n"
 				"  modulus: an unsigned integer representing the modulus as generated by the keygen command\n"
@@ -211,20 +262,23 @@ void print_specific_usage(const enum e_command command, const bool in_error) {
 				"behavior:\n"
 				"  if plaintext is '-', the message is read from stdin. If the message is provided from stdin, no encrypted trailing newline is added.\n"
 				"  in both cases (reading from stdin and from the argument) an actual trailing newline is added per the POSIX definition of a line.\n"
-				"  the output is unsigned integers separated by the delimiter specified with -d or a space by default.\n",
+				"  the output is unsigned integers separated by the delimiter specified with -d or a space by default.\n"
+				"  with --in-dir and --out-dir, each file is encrypted as if it were read from stdin.\n",
 				in_error ? stderr : stdout
 			); break;
 		case DECRYPT:
 			fputs(
 				"HELP WITH decrypt:\n"
 				"  decrypt <key> <modulus> <ciphertext>\n"
+				"  decrypt <key> <modulus> --in-dir <dir> --out-dir <dir>\n"
 				"arguments:\n"
 				"  key: an unsigned integer representing the public/private key as generated by the keygen command. make sure it is the paired key to the one used to encrypt\n"
 				"  modulus: an unsigned integer representing the modulus as generated by the keygen command\n"
 				"  ciphertext: the message you want to decrypt, in the format of unsigned integers separated by spaces or a custom delimiter specified by -d. please provide as one argument by using quotes\n"
 				"behavior:\n"
 				"  if ciphertext is '-', the message is read from stdin.\n"
-				"  in both cases (reading from stdin and from the argument) no actual trailing newline is added since it should have been encrypted along with the message.\n",
+				"  in both cases (reading from stdin and from the argument) no actual trailing newline is added since it should have been encrypted along with the message.\n"
+				"  with --in-dir and --out-dir, each file is decrypted as if it were read from stdin.\n",
 				in_error ? stderr : stdout
 			); break;
 		case KEYGEN:
@@ -235,7 +289,19 @@ void print_specific_usage(const enum e_command command, const bool in_error) {
 				"  (none)\n"
 				"behavior:\n"
 				"  the output is a public/private keypair and a modulus.\n"
-				"  in quiet mode (-q), the numbers are output without labels, in public private modulus order (same as default).",
+				"  in quiet mode (-q), the numbers are output without labels, in public private modulus order (same as default).\n"
+				"  with --prime-cache, the primes are taken from the cache (falling back to a random search if it runs dry), and removed from it before the keys are output. run primegen to top it up again.\n",
+				in_error ? stderr : stdout
+			); break;
+		case PRIMEGEN:
+			fputs(
+				"HELP WITH primegen:\n"
+				"  primegen [count]\n"
+				"arguments:\n"
+				"  count: how many primes the cache should hold afterwards, at most " STRINGIFY(PRIME_POOL_CAPACITY) " (the default). capped at the number of primes in range, since the cache never holds one twice\n"
+				"behavior:\n"
+				"  requires --prime-cache. tops up the cache file with verified primes so later keygen runs don't have to search for them.\n"
+				"  the cache file is created with permissions 0600 if it doesn't exist.\n",
 				in_error ? stderr : stdout
 			); break;
 	}
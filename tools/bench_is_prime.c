@@ -0,0 +1,61 @@
+/*
+rsa: a simple implementation of RSA encryption and decryption, as
+well as key generation with small primes (8 bits).
+Copyright (C) 2021  Matt Fellenz <mattf53190@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+// measures is_prime throughput, for tuning NUM_LOW_PRIMES against Miller-Rabin cost. run with `make bench`.
+// candidates are odd and above 2^31, so the ones trial division doesn't settle exercise Miller-Rabin.
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "util.h"
+#include "main.h"
+
+#define BENCH_CANDIDATES 2000000
+
+enum e_verbosity verbosity = QUIET;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+	unsigned int* const candidates = malloc(BENCH_CANDIDATES * sizeof(*candidates));
+	if (candidates == NULL) {
+		perror("bench_is_prime");
+		return EXIT_FAILURE;
+	}
+	uint32_t state = 0x9e3779b9; // xorshift32, fixed seed so runs are comparable
+	for (size_t i = 0; i < BENCH_CANDIDATES; i++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		candidates[i] = (unsigned int)(state | 0x80000001u);
+	}
+
+	const double start = now();
+	unsigned int primes = 0;
+	for (size_t i = 0; i < BENCH_CANDIDATES; i++) primes += is_prime(candidates[i]);
+	const double elapsed = now() - start;
+
+	printf("is_prime: %.0f candidates/sec, %u primes\n", BENCH_CANDIDATES / elapsed, primes);
+	free(candidates);
+	return EXIT_SUCCESS;
+}
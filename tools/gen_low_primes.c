@@ -0,0 +1,58 @@
+/*
+rsa: a simple implementation of RSA encryption and decryption, as
+well as key generation with small primes (8 bits).
+Copyright (C) 2021  Matt Fellenz <mattf53190@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+// emits the trial division table used by is_prime in src/util.c. run by the Makefile, not installed.
+// each odd prime p is stored with its inverse mod 2^32 and floor((2^32 - 1) / p), so that
+// p divides n exactly when n * inverse (mod 2^32) <= limit. see Granlund & Montgomery 1994.
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+static bool is_small_prime(const uint32_t n) {
+	for (uint32_t d = 3; d * d <= n; d += 2) {
+		if (n % d == 0) return false;
+	}
+	return true;
+}
+
+int main(const int argc, const char* const* const argv) {
+	if (argc != 2) {
+		fputs("usage: gen_low_primes <number of primes>\n", stderr);
+		return EXIT_FAILURE;
+	}
+	const unsigned long count = strtoul(argv[1], NULL, 0);
+	if (count == 0 || count > 6000) { // is_prime stops at sqrt(n) < 65536, and the 6000th odd prime is 59369
+		fputs("gen_low_primes: number of primes must be between 1 and 6000\n", stderr);
+		return EXIT_FAILURE;
+	}
+	puts("// generated by tools/gen_low_primes.c, do not edit");
+	printf("#define NUM_LOW_PRIMES %lu\n", count);
+	puts("static const struct LowPrime low_primes[NUM_LOW_PRIMES] = {");
+	unsigned long found = 0;
+	for (uint32_t n = 3; found < count; n += 2) {
+		if (!is_small_prime(n)) continue;
+		uint32_t inverse = n; // correct to 3 bits for odd n, each newton step doubles that
+		for (int i = 0; i < 4; i++) inverse *= 2 - n * inverse;
+		printf("\t{%" PRIu32 "u, %" PRIu32 "u, %" PRIu32 "u},\n", n, inverse, UINT32_MAX / n);
+		found++;
+	}
+	puts("};");
+	return EXIT_SUCCESS;
+}